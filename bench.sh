@@ -0,0 +1,87 @@
+#!/bin/sh
+##
+## @file bench.sh
+##
+## @brief runs a mix of orders against the server and client of each given build directory and prints the throughput
+##
+## @details "make pgo" uses this as the training workload of the instrumented build.
+##          the first directory is the baseline the throughput of the others is compared to.
+##          usage: bench.sh dir [dir ...]
+##          BENCH_ORDERS orders (default 200000) are streamed over BENCH_CONNS connections (default 4),
+##          BENCH_PORT is the tcp port of the server (default 18210).
+##          the water runs out after about 85% of the orders and the bin is full after about 95%,
+##          so the error replies are part of the mix as well.
+##
+
+if [ $# -lt 1 ]; then
+    echo "usage: bench.sh dir [dir ...]" >&2
+    exit 1
+fi
+
+orders=${BENCH_ORDERS:-200000}
+conns=${BENCH_CONNS:-4}
+port=${BENCH_PORT:-18210}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+## espresso, lungo and big cups of all flavors, some odd sizes and some invalid lines - the same mix on every run
+awk -v n="$orders" 'BEGIN {
+    srand(1821);
+    split("Kazaar Dharkan Roma Livanto Volluto Cosi Cappricio Appregio Caramelito Vanilio Ciocattino", names, " ");
+    for (i = 0; i < n; i++) {
+        r = rand();
+        if (r < 0.35) size = 40; else if (r < 0.65) size = 110; else if (r < 0.85) size = 230; else if (r < 0.90) size = 330; else size = int(rand() * 331);
+        flavor = names[int(rand() * 11) + 1];
+        if (rand() < 0.001) { print size " Mocca"; continue; }
+        if (rand() < 0.5) print size " " flavor; else print size "," flavor;
+    }
+}' > "$tmp/orders"
+
+liters=$(awk '{ sum += $1 } END { printf "%d", sum * 0.85 / 1000 + 1 }' "$tmp/orders")
+cups=$((orders * 95 / 100 + 100))
+
+## prints the orders per second of the server and client in directory $1
+run() {
+    sock="$tmp/server.sock"
+    "$1/server" -p "$port" -u "$sock" -l "$liters" -c "$cups" > /dev/null &
+    pid=$!
+    i=0
+    while [ ! -S "$sock" ]; do
+        i=$((i + 1))
+        if [ $i -gt 50 ] || ! kill -0 $pid 2> /dev/null; then
+            echo "bench.sh: server in $1 did not start" >&2
+            kill -INT $pid 2> /dev/null
+            exit 1
+        fi
+        sleep 0.1
+    done
+
+    ## single orders over tcp - one connection per order
+    i=0
+    while [ $i -lt 100 ]; do
+        "$1/client" -p "$port" 40 Roma > /dev/null
+        i=$((i + 1))
+    done
+
+    start=$(date +%s%N)
+    "$1/client" -u "$sock" -j "$conns" -f "$tmp/orders" > /dev/null
+    end=$(date +%s%N)
+
+    ## SIGINT lets the server exit normally, so an instrumented build writes its profile
+    kill -INT $pid
+    wait $pid
+    echo $((orders * 1000000000 / (end - start)))
+}
+
+printf "%-20s %12s %10s\n" "build" "orders/s" "delta"
+base=""
+for dir in "$@"; do
+    rate=$(run "$dir") || exit 1
+    if [ -z "$base" ]; then
+        base=$rate
+        printf "%-20s %12d\n" "$dir" "$rate"
+    else
+        printf "%-20s %12d %+9.1f%%\n" "$dir" "$rate" "$(awk -v r="$rate" -v b="$base" 'BEGIN { print (r - b) * 100 / b }')"
+    fi
+done
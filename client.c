@@ -20,11 +20,14 @@
 #include <stdarg.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <signal.h>
 #include <errno.h>
 #include <limits.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "coffeemaker.h"
 
@@ -44,6 +47,11 @@ static int sockfd = -1;
  */
 char *hostname = "localhost";
 
+/**
+ * @brief Path of the unix domain socket to connect to - default is NULL which means tcp is used
+ */
+char *sockpath = NULL;
+
 /**
  * @brief coffee flavor - default is -1 which means not set
  */
@@ -59,6 +67,80 @@ char* flavor_str;
  */
 int size = -1;
 
+/**
+ * @brief file to read a stream of orders from ("-" for stdin) - default is NULL which means a single order from the arguments
+ */
+char *orderfile = NULL;
+
+/**
+ * @brief id the server queues the orders of this client by (0-511) - default is -1 which means only the address is used
+ */
+int client_id = -1;
+
+/**
+ * @brief Default number of connections the orders of a stream are spread over
+ */
+int nconns = 4;
+
+/**
+ * @brief Maximum number of orders of a stream that are sent but not answered yet
+ */
+#define BULK_WINDOW 256
+
+/**
+ * @brief Maximum length of a line in a stream of orders
+ */
+#define BULK_LINE 256
+
+/**
+ * @brief Size of the buffer a stream of orders is read into
+ */
+#define BULK_INPUT 4096
+
+/**
+ * @brief Size of the flavor hash table - a power of two more than twice the number of flavors
+ */
+#define FLAVOR_TABLE_SIZE 32
+
+/**
+ * @brief hash table from the hash of a flavor name to its index in coffeeNames, -1 for empty slots
+ */
+static int flavor_table[FLAVOR_TABLE_SIZE];
+
+/**
+ * @brief a connection of a stream of orders with its buffered frames and replies
+ */
+struct bulk_conn {
+    int fd;
+    uint8_t out[2 * BULK_WINDOW + 2];   /* frames not sent yet, the client-id frame and up to BULK_WINDOW orders */
+    size_t outlen;
+    uint8_t in[BULK_WINDOW];        /* replies received but not printed yet */
+    size_t inpos;
+    size_t inlen;
+};
+
+/**
+ * @brief input of a stream of orders read but not parsed yet
+ */
+static char inbuf[BULK_INPUT];
+static size_t inpos = 0;
+static size_t inlen = 0;
+
+/**
+ * @brief the connections of a stream of orders
+ */
+static struct bulk_conn *bulk_conns = NULL;
+
+/**
+ * @brief an order of a stream that waits for its reply
+ */
+struct pending {
+    unsigned long line;     /* line of the order in the input */
+    int size;
+    int flavor;             /* -1 if the line is no valid order */
+    int conn;               /* index into bulk_conns the order was sent on */
+};
+
 
 /**
  * @brief terminate program on program error
@@ -96,6 +178,82 @@ static int send_all(int fd, uint8_t *buffer, size_t n);
  */
 static uint8_t *receive_all(int fd, uint8_t *buffer, size_t n);
 
+/**
+ * @brief Connect to the server, through its unix domain socket if a path is given and through tcp otherwise
+ * @return the file descriptor of the connected socket
+ */
+static int connect_server(void);
+
+/**
+ * @brief Hash a flavor name (FNV-1a)
+ * @param name the flavor name
+ * @return the hash of the name
+ */
+static uint32_t hash_flavor(const char *name);
+
+/**
+ * @brief Fill the flavor hash table from coffeeNames
+ */
+static void build_flavor_table(void);
+
+/**
+ * @brief Look up a flavor name in the flavor hash table
+ * @param name the flavor name
+ * @return the id of the flavor or -1 if there is no such flavor
+ */
+static int lookup_flavor(const char *name);
+
+/**
+ * @brief Build the message for an order: 5 bits flavor, 9 bits size, 1 parity bit
+ * @param size the size of the cup
+ * @param flavor the id of the flavor
+ * @param buff the 2 bytes to write the message to
+ */
+static void encode_order(int size, int flavor, uint8_t *buff);
+
+/**
+ * @brief Check the parity bit of a reply of the server
+ * @param reply the reply
+ * @return 0 if the parity bit matches, -1 otherwise
+ */
+static int check_parity(uint8_t reply);
+
+/**
+ * @brief Print when the coffee will be ready or why it cannot be made
+ * @param reply the reply of the server
+ */
+static void print_reply(uint8_t reply);
+
+/**
+ * @brief Parse a line of a stream of orders, either "size flavor" or "size,flavor"
+ * @param line the line, it is modified
+ * @param size where the size is stored
+ * @return the id of the flavor, -1 if the line is no valid order and -2 if it is empty or a comment
+ */
+static int parse_order_line(char *line, int *size);
+
+/**
+ * @brief Read the next line of a stream of orders, waits for more input if none is buffered
+ * @param fd the stream to read from
+ * @param line where the line is stored without its newline
+ * @param n the size of line
+ * @return 1 if a line was read, -1 if the line was too long and is cut, 0 at the end of the input
+ */
+static int read_line(int fd, char *line, size_t n);
+
+/**
+ * @brief Check if a line can be read from a stream of orders without waiting
+ * @param fd the stream to read from
+ * @return 1 if input is buffered or the stream is readable, 0 otherwise
+ */
+static int input_ready(int fd);
+
+/**
+ * @brief Read a stream of orders, send them pipelined over nconns connections and print the replies in input order
+ * @param fd the stream to read from
+ */
+static void run_bulk(int fd);
+
 
 static void bail_out(int exitcode, const char *fmt, ...) {
     va_list ap;
@@ -119,6 +277,15 @@ static void free_resources(void) {
     if(sockfd >= 0) {
         (void) close(sockfd);
     }
+    if (bulk_conns != NULL) {
+        for (int i = 0; i < nconns; i++) {
+            if (bulk_conns[i].fd >= 0) {
+                (void) close(bulk_conns[i].fd);
+            }
+        }
+        free(bulk_conns);
+        bulk_conns = NULL;
+    }
 }
 
 static void parse_args(int argc, char **argv) {
@@ -126,30 +293,83 @@ static void parse_args(int argc, char **argv) {
         progname = argv[0];
     }
     int opt;
-    while ((opt = getopt(argc, argv, "p:h:")) != -1) {
+    while ((opt = getopt(argc, argv, "p:h:u:i:f:j:")) != -1) {
         int pflag = 0;
         int hflag = 0;
+        int uflag = 0;
+        int fflag = 0;
+        int jflag = 0;
+        int iflag = 0;
+        char *endptr;
         switch (opt) {
         case 'p':
             if (pflag) {
-                bail_out(EXIT_FAILURE, "only one portnumber - usage: client [-h hostname] [-p portno] size flavor");
+                bail_out(EXIT_FAILURE, "only one portnumber - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
             }
             portno = optarg;
             pflag = 1;
             break;
         case 'h':
             if (hflag) {
-                bail_out(EXIT_FAILURE, "only one hostnumber - usage: client [-h hostname] [-p portno] size flavor");
+                bail_out(EXIT_FAILURE, "only one hostnumber - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
             }
             portno = optarg;
             hflag = 1;
             break;
+        case 'u':
+            if (uflag) {
+                bail_out(EXIT_FAILURE, "only one socket path - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
+            }
+            sockpath = optarg;
+            uflag = 1;
+            break;
+        case 'i':
+            if (iflag) {
+                bail_out(EXIT_FAILURE, "only one id - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
+            }
+            iflag = 1;
+            errno = 0;
+            client_id = strtol(optarg, &endptr, 10);
+            if ((errno == ERANGE && (client_id == LONG_MAX || client_id == LONG_MIN)) || (errno != 0 && client_id == 0) || endptr == optarg) {
+                bail_out(EXIT_FAILURE, "no valid int as id");
+            }
+            if (client_id < 0 || client_id > 511) {
+                bail_out(EXIT_FAILURE, "no valid id - must be between 0 and 511 (inclusive)");
+            }
+            break;
+        case 'f':
+            if (fflag) {
+                bail_out(EXIT_FAILURE, "only one order file - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
+            }
+            orderfile = optarg;
+            fflag = 1;
+            break;
+        case 'j':
+            if (jflag) {
+                bail_out(EXIT_FAILURE, "only input conns once - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
+            }
+            jflag = 1;
+            errno = 0;
+            nconns = strtol(optarg, &endptr, 10);
+            if ((errno == ERANGE && (nconns == LONG_MAX || nconns == LONG_MIN)) || (errno != 0 && nconns == 0) || endptr == optarg) {
+                bail_out(EXIT_FAILURE, "no valid int as conns");
+            }
+            if (nconns < 1 || nconns > BULK_WINDOW) {
+                bail_out(EXIT_FAILURE, "no valid number of connections - must be between 1 and %d (inclusive)", BULK_WINDOW);
+            }
+            break;
         default:
-            bail_out(EXIT_FAILURE, "unknown input - usage: client [-h hostname] [-p portno] size flavor");
+            bail_out(EXIT_FAILURE, "unknown input - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
+        }
+    }
+    if (orderfile != NULL) {
+        if (optind != argc) {
+            bail_out(EXIT_FAILURE, "either an order file or size and flavor - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
         }
+        return;
     }
     if (optind != argc-2) {
-        bail_out(EXIT_FAILURE, "enter size and flavor- usage: client [-h hostname] [-p portno] size flavor");
+        bail_out(EXIT_FAILURE, "enter size and flavor- usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
     }
     char* size_str = argv[optind];
     char *endptr;
@@ -162,30 +382,9 @@ static void parse_args(int argc, char **argv) {
         bail_out(EXIT_FAILURE, "no valid size - must be between 0 and 330 (inclusive)");
     }
     flavor_str = argv[optind+1];
-    if (strcmp(flavor_str, "Kazaar") == 0) {
-        flavor = Kazaar;
-    } else if (strcmp(flavor_str, "Dharkan") == 0) {
-        flavor = Dharkan;
-    } else if (strcmp(flavor_str, "Roma") == 0) {
-        flavor = Roma;
-    } else if (strcmp(flavor_str, "Livanto") == 0) {
-        flavor = Livanto;
-    } else if (strcmp(flavor_str, "Volluto") == 0) {
-        flavor = Volluto;
-    } else if (strcmp(flavor_str, "Cosi") == 0) {
-        flavor = Cosi;
-    } else if (strcmp(flavor_str, "Cappricio") == 0) {
-        flavor = Cappricio;
-    } else if (strcmp(flavor_str, "Appregio") == 0) {
-        flavor = Appregio;
-    } else if (strcmp(flavor_str, "Caramelito") == 0) {
-        flavor = Caramelito;
-    } else if (strcmp(flavor_str, "Vanilio") == 0) {
-        flavor = Vanilio;
-    } else if (strcmp(flavor_str, "Ciocattino") == 0) {
-        flavor = Ciocattino;
-    } else {
-        bail_out(EXIT_FAILURE, "no known flavor - usage: client [-h hostname] [-p portno] size flavor");
+    flavor = lookup_flavor(flavor_str);
+    if (flavor < 0) {
+        bail_out(EXIT_FAILURE, "no known flavor - usage: client [-h hostname] [-p portno] [-u sockpath] [-i id] [-j conns] {-f file | size flavor}");
     }
 }
 
@@ -222,49 +421,101 @@ static uint8_t *receive_all(int fd, uint8_t *buffer, size_t n) {
     return buffer;
 }
 
-int main(int argc, char *argv[]) {
+static int connect_server(void) {
+    int fd = -1;
+    if (sockpath != NULL) {
+        /* the server runs on the same host - connect through its unix domain socket instead of tcp */
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        if (strlen(sockpath) >= sizeof(addr.sun_path)) {
+            bail_out(EXIT_FAILURE, "socket path too long");
+        }
+        strcpy(addr.sun_path, sockpath);
 
-    parse_args(argc, argv);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            bail_out(EXIT_FAILURE, "could not create socket");
+        }
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) == -1) {
+            bail_out(EXIT_FAILURE, "connect − Connection refused");
+        }
+    } else {
+        /* create socket fd */
+        /* AF_INET for ipv4
+           SOCK_STREAM for a sequenced, reliable, two-way, connection-based byte stream */
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            bail_out(EXIT_FAILURE, "could not create socket");
+        }
 
-    /* create socket sockfd */
-    /* AF_INET for ipv4
-       SOCK_STREAM for a sequenced, reliable, two-way, connection-based byte stream */
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        bail_out(EXIT_FAILURE, "could not create socket");
-    }
-
-    /* connect socket by default to localhost:1821 (some random free port I chose) */
-    /* man 3 getaddrinfo shows an example of doing this by building a complete struct addrinfo */
-    /* htons can be used to convert values between host and network byte order */
-    struct addrinfo hints;
-    struct addrinfo *result, *rp;
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = 0;
-
-    if (getaddrinfo(hostname, portno, (struct addrinfo *) &hints, &result) != 0) {
-        bail_out(EXIT_FAILURE, "could not getaddrinfo");
-    }
-
-    /* getaddrinfo returns a list of addrinfos - in a loop try to connect to any of them */
-    int connect_success = 0;
-    for (rp = result; rp != NULL; rp = rp->ai_next) {
-        if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) != -1) {
-            connect_success = 1;
-            break;
+        /* connect socket by default to localhost:1821 (some random free port I chose) */
+        /* man 3 getaddrinfo shows an example of doing this by building a complete struct addrinfo */
+        /* htons can be used to convert values between host and network byte order */
+        struct addrinfo hints;
+        struct addrinfo *result, *rp;
+        memset(&hints, 0, sizeof(struct addrinfo));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = 0;
+
+        if (getaddrinfo(hostname, portno, (struct addrinfo *) &hints, &result) != 0) {
+            bail_out(EXIT_FAILURE, "could not getaddrinfo");
+        }
+
+        /* getaddrinfo returns a list of addrinfos - in a loop try to connect to any of them */
+        int connect_success = 0;
+        for (rp = result; rp != NULL; rp = rp->ai_next) {
+            if (connect(fd, rp->ai_addr, rp->ai_addrlen) != -1) {
+                connect_success = 1;
+                break;
+            }
+        }
+
+        freeaddrinfo(result);
+
+        if (connect_success == 0 || rp == NULL) {
+            bail_out(EXIT_FAILURE, "connect − Connection refused");
         }
     }
+    return fd;
+}
 
-    freeaddrinfo(result);
+static uint32_t hash_flavor(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        hash = hash ^ (uint8_t) *name;
+        hash = hash * 16777619u;
+    }
+    return hash;
+}
 
-    if (connect_success == 0 || rp == NULL) {
-        bail_out(EXIT_FAILURE, "connect − Connection refused");
+static void build_flavor_table(void) {
+    for (int i = 0; i < FLAVOR_TABLE_SIZE; i++) {
+        flavor_table[i] = -1;
     }
+    /* open addressing - on a collision take the next free slot */
+    for (int i = 0; i < COUNT_OF(coffeeNames); i++) {
+        uint32_t slot = hash_flavor(coffeeNames[i]) & (FLAVOR_TABLE_SIZE - 1);
+        while (flavor_table[slot] != -1) {
+            slot = (slot + 1) & (FLAVOR_TABLE_SIZE - 1);
+        }
+        flavor_table[slot] = i;
+    }
+}
 
-    printf("Requesting a %dml cup of coffee of flavour '%s' (id=%d)\n", size, flavor_str, flavor);
+static int lookup_flavor(const char *name) {
+    uint32_t slot = hash_flavor(name) & (FLAVOR_TABLE_SIZE - 1);
+    while (flavor_table[slot] != -1) {
+        if (strcmp(coffeeNames[flavor_table[slot]], name) == 0) {
+            return flavor_table[slot];
+        }
+        slot = (slot + 1) & (FLAVOR_TABLE_SIZE - 1);
+    }
+    return -1;
+}
 
+static void encode_order(int size, int flavor, uint8_t *buff) {
     /* message to send: 2 bytes 
         use an unsigned integer
         -----|---------|- : 5 bits flavor, 9 bits size, 1 parity bit */
@@ -281,37 +532,29 @@ int main(int argc, char *argv[]) {
     }
     mess = mess | parity_bit;
 
-    uint8_t buff[2];
     buff[0] = mess;
     buff[1] = mess >> 8;
+}
 
-    /* send message with all needed information to the server */
-    if (send_all(sockfd, buff, 2) == -1) {
-        bail_out(EXIT_FAILURE, "sending the information to the server did not work");
-    }
-
-    uint8_t buffer[1];
-
-    /* receive message of server with feedback */
-    if (receive_all(sockfd, buffer, 1) == NULL) {
-        bail_out(EXIT_FAILURE, "could not receive data from server");
-    }
-
-    /* check the parity bit */
+static int check_parity(uint8_t reply) {
     uint8_t parity_bit_check = 0;
     for (int i = 1; i < 9; i++) {
-        int bit = buffer[0] >> i;
+        int bit = reply >> i;
         bit = bit & 1;
         parity_bit_check = parity_bit_check ^ bit;
     }
-    if ((buffer[0]&1) != parity_bit_check) {
-        bail_out(EXIT_FAILURE, "parity bit does not match\n");
+    if ((reply&1) != parity_bit_check) {
+        return -1;
     }
-    int ok = buffer[0];
+    return 0;
+}
+
+static void print_reply(uint8_t reply) {
+    int ok = reply;
     ok = ok >> 1;
     ok = ok & 1;
     if (ok == 0) {
-        int seconds = buffer[0];
+        int seconds = reply;
         seconds = seconds >> 2;
         seconds = seconds & 63;
         if (seconds < 63) {
@@ -320,7 +563,7 @@ int main(int argc, char *argv[]) {
             printf("Coffee ready in 63 seconds or more.\n");
         }
     } else {
-        int error = buffer[0];
+        int error = reply;
         error = error >> 2;
         error = error & 3;
         char* error_name;
@@ -335,6 +578,239 @@ int main(int argc, char *argv[]) {
         }
         printf("Error %d - %s\n", error, error_name);
     }
+}
+
+static int parse_order_line(char *line, int *size) {
+    char *size_str = strtok(line, " \t,\r\n");
+    if (size_str == NULL || size_str[0] == '#') {
+        return -2;
+    }
+    char *name = strtok(NULL, " \t,\r\n");
+    if (name == NULL || strtok(NULL, " \t,\r\n") != NULL) {
+        return -1;
+    }
+    char *endptr;
+    errno = 0;
+    long l = strtol(size_str, &endptr, 10);
+    if (errno != 0 || endptr == size_str || *endptr != '\0' || l < 0 || l > 330) {
+        errno = 0;
+        return -1;
+    }
+    *size = l;
+    return lookup_flavor(name);
+}
+
+static int read_line(int fd, char *line, size_t n) {
+    size_t len = 0;
+    int too_long = 0;
+    while (1) {
+        if (inpos == inlen) {
+            /* the replies printed so far are shown before waiting for more input */
+            (void) fflush(stdout);
+            ssize_t r = read(fd, inbuf, sizeof(inbuf));
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                bail_out(EXIT_FAILURE, "could not read orders");
+            }
+            if (r == 0) {
+                if (len == 0 && !too_long) {
+                    return 0;
+                }
+                break;
+            }
+            inpos = 0;
+            inlen = r;
+        }
+        char *start = inbuf + inpos;
+        char *nl = memchr(start, '\n', inlen - inpos);
+        size_t part = nl != NULL ? (size_t) (nl - start) : inlen - inpos;
+        if (part > n - 1 - len) {
+            part = n - 1 - len;
+            too_long = 1;
+        }
+        memcpy(line + len, start, part);
+        len += part;
+        if (nl != NULL) {
+            inpos = nl - inbuf + 1;
+            break;
+        }
+        inpos = inlen;
+    }
+    line[len] = '\0';
+    return too_long ? -1 : 1;
+}
+
+static int input_ready(int fd) {
+    if (inpos < inlen) {
+        return 1;
+    }
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    /* end of input and errors count as ready as well, read_line reports them */
+    return poll(&pfd, 1, 0) != 0;
+}
+
+static void run_bulk(int fd) {
+    bulk_conns = malloc((size_t) nconns * sizeof(struct bulk_conn));
+    if (bulk_conns == NULL) {
+        bail_out(EXIT_FAILURE, "could not allocate connections");
+    }
+    for (int i = 0; i < nconns; i++) {
+        bulk_conns[i].fd = -1;
+    }
+    for (int i = 0; i < nconns; i++) {
+        bulk_conns[i].fd = connect_server();
+        bulk_conns[i].outlen = 0;
+        if (client_id >= 0) {
+            encode_order(client_id, CLIENT_ID_FLAVOR, bulk_conns[i].out);
+            bulk_conns[i].outlen = 2;
+        }
+        bulk_conns[i].inpos = 0;
+        bulk_conns[i].inlen = 0;
+    }
+
+    /* orders are sent round robin over the connections and the server answers the orders of a connection in order,
+       so the reply of the oldest pending order is always the next reply on its connection.
+       at most BULK_WINDOW orders are pending, so memory stays the same no matter how long the input is.
+       orders are only collected while more input is ready - once reading would wait, the queued orders are sent,
+       so a slow producer gets its replies right away */
+    static struct pending window[BULK_WINDOW];
+    size_t head = 0;
+    size_t count = 0;
+    int next_conn = 0;
+    unsigned long lineno = 0;
+    char line[BULK_LINE];
+    int eof = 0;
+
+    while (!eof || count > 0) {
+        if (!eof && count < BULK_WINDOW && (count == 0 || input_ready(fd))) {
+            int r = read_line(fd, line, sizeof(line));
+            if (r == 0) {
+                eof = 1;
+                continue;
+            }
+            lineno++;
+            int size = 0;
+            int flavor = -1;
+            if (r == 1) {
+                flavor = parse_order_line(line, &size);
+            }
+            if (flavor == -2) {
+                continue;
+            }
+
+            struct pending *p = &window[(head + count) % BULK_WINDOW];
+            p->line = lineno;
+            p->size = size;
+            p->flavor = flavor;
+            p->conn = -1;
+            if (flavor >= 0) {
+                struct bulk_conn *c = &bulk_conns[next_conn];
+                encode_order(size, flavor, c->out + c->outlen);
+                c->outlen += 2;
+                p->conn = next_conn;
+                next_conn = (next_conn + 1) % nconns;
+            }
+            count++;
+            continue;
+        }
+
+        /* the window is full, no input is ready or the input is done - print the oldest pending order */
+        struct pending *p = &window[head];
+        if (p->flavor < 0) {
+            printf("line %lu: no valid order\n", p->line);
+        } else {
+            struct bulk_conn *c = &bulk_conns[p->conn];
+            if (c->inpos == c->inlen) {
+                /* no reply buffered - send everything that is queued and wait for the server */
+                for (int i = 0; i < nconns; i++) {
+                    if (bulk_conns[i].outlen > 0) {
+                        if (send_all(bulk_conns[i].fd, bulk_conns[i].out, bulk_conns[i].outlen) == -1) {
+                            bail_out(EXIT_FAILURE, "sending the information to the server did not work");
+                        }
+                        bulk_conns[i].outlen = 0;
+                    }
+                }
+                ssize_t r;
+                do {
+                    r = recv(c->fd, c->in, BULK_WINDOW, 0);
+                } while (r < 0 && errno == EINTR);
+                if (r <= 0) {
+                    bail_out(EXIT_FAILURE, "could not receive data from server");
+                }
+                c->inpos = 0;
+                c->inlen = r;
+            }
+            uint8_t reply = c->in[c->inpos++];
+            printf("%d %s: ", p->size, coffeeNames[p->flavor]);
+            if (check_parity(reply) == -1) {
+                printf("parity bit does not match\n");
+            } else {
+                print_reply(reply);
+            }
+        }
+        head = (head + 1) % BULK_WINDOW;
+        count--;
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    build_flavor_table();
+
+    parse_args(argc, argv);
+
+    if (orderfile != NULL) {
+        int in = STDIN_FILENO;
+        if (strcmp(orderfile, "-") != 0) {
+            in = open(orderfile, O_RDONLY);
+            if (in < 0) {
+                bail_out(EXIT_FAILURE, "could not open %s", orderfile);
+            }
+        }
+        run_bulk(in);
+        if (in != STDIN_FILENO) {
+            (void) close(in);
+        }
+        free_resources();
+        return 0;
+    }
+
+    sockfd = connect_server();
+
+    printf("Requesting a %dml cup of coffee of flavour '%s' (id=%d)\n", size, flavor_str, flavor);
+
+    /* the client-id frame goes in front of the order, the server does not reply to it */
+    uint8_t buff[4];
+    size_t len = 0;
+    if (client_id >= 0) {
+        encode_order(client_id, CLIENT_ID_FLAVOR, buff);
+        len = 2;
+    }
+    encode_order(size, flavor, buff + len);
+    len += 2;
+
+    /* send message with all needed information to the server */
+    if (send_all(sockfd, buff, len) == -1) {
+        bail_out(EXIT_FAILURE, "sending the information to the server did not work");
+    }
+
+    uint8_t buffer[1];
+
+    /* receive message of server with feedback */
+    if (receive_all(sockfd, buffer, 1) == NULL) {
+        bail_out(EXIT_FAILURE, "could not receive data from server");
+    }
+
+    /* check the parity bit */
+    if (check_parity(buffer[0]) == -1) {
+        bail_out(EXIT_FAILURE, "parity bit does not match\n");
+    }
+    print_reply(buffer[0]);
 
     free_resources();
-}
\ No newline at end of file
+}
@@ -18,6 +18,17 @@
 #endif
 
 
+/**
+ * @brief Static tracepoint of the provider coffeemaker for perf and bpftrace (needs sys/sdt.h), nothing if not built with ENSDT
+ */
+#ifdef ENSDT
+#include <sys/sdt.h>
+#define TRACE(name, ...) STAP_PROBEV(coffeemaker, name, __VA_ARGS__)
+#else
+#define TRACE(name, ...)
+#endif
+
+
  /**
  * @brief Length of an array
  */
@@ -30,10 +41,15 @@
 char *portno = "1821";
 
 /**
- * @brief enum of existing coffee-flavors (up to 32 are allowed)
+ * @brief enum of existing coffee-flavors (up to 31 are allowed, the id 31 is CLIENT_ID_FLAVOR)
  */
 enum { Kazaar, Dharkan, Roma, Livanto, Volluto, Cosi, Cappricio, Appregio, Caramelito, Vanilio, Ciocattino };
 
+/**
+ * @brief flavor that marks a client-id frame: its 9 size bits carry an id (0-511) that the server uses together with the address of the client to queue its orders fairly. the server does not reply to it
+ */
+#define CLIENT_ID_FLAVOR 31
+
 /**
  * @brief the different coffee flavors the coffemaker currently can make
  */
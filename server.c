@@ -12,6 +12,9 @@
  * 
  */
 
+/* struct ucred for SO_PEERCRED */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,11 +23,16 @@
 #include <stdarg.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <signal.h>
 #include <errno.h>
 #include <limits.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <time.h>
 
 #include "coffeemaker.h"
@@ -45,15 +53,205 @@ int liters = 1;
  */
 int cups = 10;
 
+/**
+ * @brief Number of cups the bin can hold, cups is the space that is left
+ */
+static int cups_capacity = 0;
+
+/**
+ * @brief Water left in the coffee machine in ml
+ */
+static int ml = 0;
+
+/**
+ * @brief timestamp which says when the coffee that is brewing right now will be finished
+ */
+static time_t brewing_until = 0;
+
 /**
  * @brief File descriptor for server socket
  */
 static int sockfd = -1;
 
 /**
- * @brief File descriptor for connection socket 
+ * @brief Path of the unix domain socket - default is NULL which means no unix socket
+ */
+static char *sockpath = NULL;
+
+/**
+ * @brief File descriptor for unix domain server socket
+ */
+static int unixfd = -1;
+
+/**
+ * @brief Path of the admin socket - default is NULL which means no admin socket
+ */
+static char *adminpath = NULL;
+
+/**
+ * @brief File descriptor for the admin socket
+ */
+static int adminfd = -1;
+
+/**
+ * @brief File descriptor of the epoll instance all sockets are registered with
+ */
+static int epfd = -1;
+
+/**
+ * @brief Size of a cache line - connection records are aligned to it
+ */
+#define CACHE_LINE 64
+
+/**
+ * @brief Number of replies that can wait on a connection before the server stops reading from it - fills up the cache line of the record
+ */
+#define CONN_REPLIES 40
+
+/**
+ * @brief Number of events fetched with one call to epoll_wait
+ */
+#define MAX_EVENTS 64
+
+/**
+ * @brief Number of admin connections served at the same time
+ */
+#define ADMIN_CONNS 4
+
+/**
+ * @brief File descriptors the server needs besides the connections of clients: stdio, listening sockets, epoll, admin connections and some to spare
+ */
+#define RESERVED_FDS (3 + 3 + 1 + ADMIN_CONNS + 8)
+
+/**
+ * @brief Maximum length of an admin command
+ */
+#define ADMIN_LINE 128
+
+/**
+ * @brief Number of queues the orders are spread over - clients are hashed to a queue, clients that share a queue share its fair share
+ */
+#define NFLOWS 256
+
+/**
+ * @brief ml a queue may brew per round of the deficit round robin - the biggest cup, so every queue gets at least one coffee per round
+ */
+#define DRR_QUANTUM 330
+
+/**
+ * @brief state of one client connection - exactly one cache line, so records of different connections never share one
+ */
+struct connection {
+    int fd;                         /* socket of the connection, -1 if the record is free */
+    uint32_t events;                /* epoll events currently registered for fd */
+    time_t last_active;             /* when the client last sent an order or was ready for replies */
+    uint16_t flow;                  /* queue the orders of the connection go to */
+    uint8_t frame[2];               /* order that is being received */
+    uint8_t received;               /* bytes of frame received so far */
+    uint8_t reply_head;             /* index of the first reply not sent yet */
+    uint8_t reply_count;            /* number of replies not sent yet */
+    uint8_t eof;                    /* 1 once the client closed its side, the connection is closed when all replies are sent */
+    uint8_t replies[CONN_REPLIES];  /* replies not sent yet */
+};
+
+/**
+ * @brief fails to compile if a connection record does not fill whole cache lines
  */
-static int connfd = -1;
+typedef char connection_size_check[(sizeof(struct connection) % CACHE_LINE == 0) ? 1 : -1];
+
+/**
+ * @brief an admin connection and the command that is being received
+ */
+struct admin_conn {
+    int fd;                     /* socket of the connection, -1 if unused */
+    char line[ADMIN_LINE];      /* command received so far */
+    size_t len;
+};
+
+/**
+ * @brief the admin connections
+ */
+static struct admin_conn admins[ADMIN_CONNS];
+
+/**
+ * @brief Default maximum number of connections served at the same time
+ */
+int maxconns = 1024;
+
+/**
+ * @brief Default seconds a connection may stay idle before the server closes it, 0 to never close idle connections
+ */
+int idle_timeout = 60;
+
+/**
+ * @brief when the connections are checked for the idle timeout and a paused accept is retried next
+ */
+static time_t next_sweep = 0;
+
+/**
+ * @brief pool of connection records, allocated once at startup
+ */
+static struct connection *conns = NULL;
+
+/**
+ * @brief stack of indices of the free records in conns
+ */
+static int *free_conns = NULL;
+
+/**
+ * @brief number of indices on the free_conns stack
+ */
+static int nfree = 0;
+
+/**
+ * @brief 1 if the listening sockets are registered for incoming connections, 0 while the pool or the file descriptors are exhausted
+ */
+static int accepting = 1;
+
+/**
+ * @brief running totals of a queue up to and including one of its coffees
+ */
+struct brew_sum {
+    int64_t ml;         /* ml of all coffees queued so far, what they cost of the share of the queue */
+    int64_t seconds;    /* seconds all coffees queued so far take to brew */
+};
+
+/**
+ * @brief queue of the coffees of the clients hashed to it
+ */
+struct flow {
+    struct brew_sum *sums;  /* totals after each queued coffee, the waiting coffees are head .. tail-1 */
+    int head;
+    int tail;
+    int cap;                /* number of entries sums has space for */
+    struct brew_sum done;   /* totals of the coffees of this queue that have been started */
+    int deficit;            /* ml this queue may still brew before its turn is over */
+};
+
+/**
+ * @brief the queues of waiting coffees
+ */
+static struct flow flows[NFLOWS];
+
+/**
+ * @brief queues with waiting coffees in round robin order
+ */
+static int active[NFLOWS];
+
+/**
+ * @brief number of entries in active
+ */
+static int nactive = 0;
+
+/**
+ * @brief index into active of the queue whose turn it is
+ */
+static int current = 0;
+
+/**
+ * @brief 1 if the current queue already got its quantum in this turn
+ */
+static int visited = 0;
 
 /**
  * @brief struct that represents a coffee and when it will be finished
@@ -91,20 +289,149 @@ static void signal_handler(int sig);
 static void parse_args(int argc, char **argv);
 
 /**
- * @brief Send all Data to the client
- * @param fd the socket to which to send to
- * @param buffer the data to be sent
- * @param n the size of the data to be sent
+ * @brief Create a listening unix domain socket for clients on the same host
+ * @param path the path in the filesystem where the socket is created
+ * @return the file descriptor of the listening socket
  */
-static int send_all(int fd, uint8_t *buffer, size_t n);
+static int listen_unix(const char *path);
 
 /**
- * @brief Read data the client sent
- * @param fd the socket to read from
- * @param the buffer to which to save the data to
- * @param n the amount of bytes to read
+ * @brief Raise the limit of open files so that n connections fit, if that is not allowed make the pool smaller
+ * @param n the number of connections that were asked for
+ * @return the number of connections that fit
  */
-static uint8_t *receive_all(int fd, uint8_t *buffer, size_t n);
+static int fit_fd_limit(int n);
+
+/**
+ * @brief Allocate the pool of connection records and print how much memory it takes
+ * @param n the number of records in the pool
+ */
+static void pool_init(int n);
+
+/**
+ * @brief Take a record from the pool of connections
+ * @return the record or NULL if all records are in use
+ */
+static struct connection *conn_alloc(void);
+
+/**
+ * @brief Give a record back to the pool of connections
+ * @param c the record
+ */
+static void conn_free(struct connection *c);
+
+/**
+ * @brief Register or unregister the listening sockets for incoming connections
+ * @param on 1 to accept connections, 0 to leave them waiting in the backlog
+ */
+static void set_accepting(int on);
+
+/**
+ * @brief Accept all pending connections on a listening socket
+ * @param listenfd the listening socket
+ */
+static void accept_clients(int listenfd);
+
+/**
+ * @brief Close a connection and give its record back to the pool
+ * @param c the connection
+ */
+static void close_connection(struct connection *c);
+
+/**
+ * @brief Close all connections that were idle for longer than the idle timeout
+ * @param now the current time
+ */
+static void close_idle_connections(time_t now);
+
+/**
+ * @brief Find the queue of a client
+ * @param fd the socket of the client
+ * @param id the id the client sent in a client-id frame, 0 if it did not send one
+ * @return the index of the queue
+ */
+static int flow_of(int fd, int id);
+
+/**
+ * @brief Start the next coffee of the queue whose turn it is in the deficit round robin, at least one queue must be active
+ * @return how long brewing the coffee takes
+ */
+static int start_next_brew(void);
+
+/**
+ * @brief Start all queued coffees whose turn came up until now
+ * @param now the current time
+ */
+static void start_brews(time_t now);
+
+/**
+ * @brief Put a coffee at the end of a queue
+ * @param flow the queue
+ * @param seconds how long brewing the coffee takes
+ * @param ml the size of the cup
+ */
+static void enqueue_brew(int flow, int seconds, int ml);
+
+/**
+ * @brief Calculate when the last coffee of a queue will be finished if no other coffee is queued before its turn
+ * @param flow the queue
+ * @return the time at which the coffee will be finished
+ */
+static time_t finish_time(int flow);
+
+/**
+ * @brief Check the parity bit of a frame
+ * @param buffer the 2 bytes the client sent
+ * @return 1 if the parity bit matches, 0 otherwise
+ */
+static int parity_ok(const uint8_t *buffer);
+
+/**
+ * @brief Calculate if an ordered coffee can be made and update the status of the coffee machine
+ * @param buffer the 2 bytes the client sent
+ * @param flow the queue of the client
+ * @return the reply byte for the client
+ */
+static uint8_t handle_order(const uint8_t *buffer, int flow);
+
+/**
+ * @brief Accept a connection on the admin socket if it comes from the user the server runs as or from root
+ */
+static void accept_admin(void);
+
+/**
+ * @brief Close an admin connection
+ * @param a the admin connection
+ */
+static void close_admin(struct admin_conn *a);
+
+/**
+ * @brief Apply an admin command to the coffee machine
+ * @param line the command, it is modified
+ * @param reply where the answer for the admin is written to
+ * @param n the size of reply
+ */
+static void admin_command(char *line, char *reply, size_t n);
+
+/**
+ * @brief Read admin commands from an admin connection and answer them
+ * @param a the admin connection
+ */
+static void serve_admin(struct admin_conn *a);
+
+/**
+ * @brief Send as many queued replies of a connection as the socket takes
+ * @param c the connection
+ * @return 0 on success, -1 if the connection failed
+ */
+static int flush_replies(struct connection *c);
+
+/**
+ * @brief Read orders from a connection and send the replies
+ * @param c the connection
+ * @param events the epoll events that occurred on the connection
+ */
+static void serve_connection(struct connection *c, uint32_t events);
 
 
 static void bail_out(int exitcode, const char *fmt, ...) {
@@ -126,12 +453,40 @@ static void bail_out(int exitcode, const char *fmt, ...) {
 }
 
 static void free_resources(void) {
-    if(connfd >= 0) {
-        (void) close(connfd);
+    if (conns != NULL) {
+        for (int i = 0; i < maxconns; i++) {
+            if (conns[i].fd >= 0) {
+                (void) close(conns[i].fd);
+            }
+        }
+        free(conns);
+        conns = NULL;
+    }
+    free(free_conns);
+    free_conns = NULL;
+    for (int i = 0; i < NFLOWS; i++) {
+        free(flows[i].sums);
+        flows[i].sums = NULL;
+    }
+    if(epfd >= 0) {
+        (void) close(epfd);
     }
     if(sockfd >= 0) {
         (void) close(sockfd);
     }
+    if(unixfd >= 0) {
+        (void) close(unixfd);
+        (void) unlink(sockpath);
+    }
+    for (int i = 0; i < ADMIN_CONNS; i++) {
+        if (admins[i].fd >= 0) {
+            (void) close(admins[i].fd);
+        }
+    }
+    if(adminfd >= 0) {
+        (void) close(adminfd);
+        (void) unlink(adminpath);
+    }
 }
 
 static void signal_handler(int sig) {
@@ -145,22 +500,68 @@ static void parse_args(int argc, char **argv) {
         progname = argv[0];
     }
     int opt;
-    while ((opt = getopt(argc, argv, "p:l:c:")) != -1) {
+    while ((opt = getopt(argc, argv, "p:l:c:u:n:a:t:")) != -1) {
         int pflag = 0;
         int lflag = 0;
         int cflag = 0;
+        int uflag = 0;
+        int nflag = 0;
+        int aflag = 0;
+        int tflag = 0;
         char *endptr;
         switch (opt) {
         case 'p':
             if (pflag) {
-                bail_out(EXIT_FAILURE, "only one portnumber - usage: server [-p portno] [-l liters] [-c cups]");
+                bail_out(EXIT_FAILURE, "only one portnumber - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
             }
             portno = optarg;
             pflag = 1;
             break;
+        case 'u':
+            if (uflag) {
+                bail_out(EXIT_FAILURE, "only one socket path - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
+            }
+            sockpath = optarg;
+            uflag = 1;
+            break;
+        case 'a':
+            if (aflag) {
+                bail_out(EXIT_FAILURE, "only one admin socket path - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
+            }
+            adminpath = optarg;
+            aflag = 1;
+            break;
+        case 'n':
+            if (nflag) {
+                bail_out(EXIT_FAILURE, "only input maxconns once - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
+            }
+            nflag = 1;
+            errno = 0;
+            maxconns = strtol(optarg, &endptr, 10);
+            if ((errno == ERANGE && (maxconns == LONG_MAX || maxconns == LONG_MIN)) || (errno != 0 && maxconns == 0) || endptr == optarg) {
+                bail_out(EXIT_FAILURE, "no valid int as maxconns");
+            }
+            if (maxconns < 1) {
+                bail_out(EXIT_FAILURE, "the server needs to accept at least 1 connection");
+            }
+            break;
+        case 't':
+            if (tflag) {
+                bail_out(EXIT_FAILURE, "only input timeout once - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
+            }
+            tflag = 1;
+            errno = 0;
+            idle_timeout = strtol(optarg, &endptr, 10);
+            if ((errno == ERANGE && (idle_timeout == LONG_MAX || idle_timeout == LONG_MIN)) || (errno != 0 && idle_timeout == 0) || endptr == optarg) {
+                bail_out(EXIT_FAILURE, "no valid int as timeout");
+            }
+            if (idle_timeout < 0) {
+                bail_out(EXIT_FAILURE, "the timeout can not be negative");
+            }
+            break;
         case 'l':
             if (lflag) {
-                bail_out(EXIT_FAILURE, "only input liters once - usage: server [-p portno] [-l liters] [-c cups]");
+                bail_out(EXIT_FAILURE, "only input liters once - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
             }
             lflag = 1;
             errno = 0;
@@ -174,7 +575,7 @@ static void parse_args(int argc, char **argv) {
             break;
         case 'c':
             if (cflag) {
-                bail_out(EXIT_FAILURE, "only input cups once - usage: server [-p portno] [-l liters] [-c cups]");
+                bail_out(EXIT_FAILURE, "only input cups once - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
             }
             cflag = 1;
             errno = 0;
@@ -187,42 +588,713 @@ static void parse_args(int argc, char **argv) {
             }
             break;
         default:
-            bail_out(EXIT_FAILURE, "unknown input - usage: server [-p portno] [-l liters] [-c cups]");
+            bail_out(EXIT_FAILURE, "unknown input - usage: server [-p portno] [-u sockpath] [-a adminpath] [-n maxconns] [-t timeout] [-l liters] [-c cups]");
         }
     }
 }
 
-static int send_all(int fd, uint8_t *buffer, size_t n) {
-  size_t bytes_sent = 0;
-  do {
-    ssize_t s = send(fd, buffer + bytes_sent, n - bytes_sent, 0);
-    if (s <= 0) {
-      return -1;
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        bail_out(EXIT_FAILURE, "socket path too long");
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        bail_out(EXIT_FAILURE, "could not create unix socket");
     }
-    bytes_sent += s;
-  } while (bytes_sent < n);
 
-  if (bytes_sent < n ) {
-    return -1;
-  }
-  return 0;
+    /* a socket left behind by a crashed server would make bind fail - only remove it if it really is a socket */
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        (void) unlink(path);
+    }
+    errno = 0;
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) != 0) {
+        (void) close(fd);
+        bail_out(EXIT_FAILURE, "could not bind unix socket");
+    }
+    if (listen(fd, 10) != 0) {
+        (void) close(fd);
+        (void) unlink(path);
+        bail_out(EXIT_FAILURE, "setup listen on unix socket failed");
+    }
+    return fd;
 }
 
-static uint8_t *receive_all(int fd, uint8_t *buffer, size_t n) {
-    size_t bytes_recv = 0;
-    do {
-        ssize_t r;
-        r = recv(fd, buffer + bytes_recv, n - bytes_recv, 0);
-        if (r <= 0) {
-            return NULL;
+static int fit_fd_limit(int n) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        bail_out(EXIT_FAILURE, "could not get limit of open files");
+    }
+    rlim_t needed = (rlim_t) n + RESERVED_FDS;
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < needed) {
+        /* the soft limit may be raised up to the hard limit without any privileges */
+        rl.rlim_cur = (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < needed) ? rl.rlim_max : needed;
+        if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+            errno = 0;
+            (void) getrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < needed) {
+        if (rl.rlim_cur <= RESERVED_FDS) {
+            bail_out(EXIT_FAILURE, "limit of open files is too low - at least %d are needed", RESERVED_FDS + 1);
         }
-        bytes_recv += r;
-    } while (bytes_recv < n);
+        int fit = rl.rlim_cur - RESERVED_FDS;
+        printf("Only %d open files allowed - serving %d instead of %d connections\n", (int) rl.rlim_cur, fit, n);
+        return fit;
+    }
+    return n;
+}
 
-    if (bytes_recv < n) {
+static void pool_init(int n) {
+    void *mem;
+    size_t size = (size_t) n * sizeof(struct connection);
+    if (posix_memalign(&mem, CACHE_LINE, size) != 0) {
+        bail_out(EXIT_FAILURE, "could not allocate connection pool");
+    }
+    conns = mem;
+    free_conns = malloc((size_t) n * sizeof(int));
+    if (free_conns == NULL) {
+        bail_out(EXIT_FAILURE, "could not allocate connection pool");
+    }
+
+    /* touch every record now so serving connections later never faults in new pages */
+    memset(conns, 0, size);
+    for (int i = 0; i < n; i++) {
+        conns[i].fd = -1;
+        /* lowest index on top of the stack so few connections stay in few cache lines */
+        free_conns[i] = n - 1 - i;
+    }
+    nfree = n;
+
+    size_t footprint = size + (size_t) n * sizeof(int);
+    printf("Connection pool: %d connections, %zu bytes per connection, %zu bytes total\n", n, sizeof(struct connection) + sizeof(int), footprint);
+}
+
+static struct connection *conn_alloc(void) {
+    if (nfree == 0) {
         return NULL;
     }
-    return buffer;
+    struct connection *c = &conns[free_conns[--nfree]];
+    memset(c, 0, sizeof(struct connection));
+    return c;
+}
+
+static void conn_free(struct connection *c) {
+    c->fd = -1;
+    free_conns[nfree++] = c - conns;
+}
+
+static void set_accepting(int on) {
+    const int listeners[] = {sockfd, unixfd};
+    for (int i = 0; i < COUNT_OF(listeners); i++) {
+        if (listeners[i] < 0) {
+            continue;
+        }
+        struct epoll_event ev;
+        ev.events = on ? EPOLLIN : 0;
+        ev.data.ptr = listeners[i] == sockfd ? (void *) &sockfd : (void *) &unixfd;
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, listeners[i], &ev) != 0) {
+            bail_out(EXIT_FAILURE, "could not change listening sockets");
+        }
+    }
+    accepting = on;
+}
+
+static void accept_clients(int listenfd) {
+    while (1) {
+        struct connection *c = conn_alloc();
+        if (c == NULL) {
+            /* all records are in use - further clients wait in the backlog until a connection is closed */
+            set_accepting(0);
+            return;
+        }
+
+        /* accept an incoming connection */
+        int fd = accept(listenfd, NULL, NULL);
+        if (fd == -1) {
+            conn_free(c);
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                errno = 0;
+                return;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                /* no file descriptor left - like a full pool, further clients wait until a connection is closed */
+                errno = 0;
+                set_accepting(0);
+                return;
+            }
+            bail_out(EXIT_FAILURE, "accept failed");
+        }
+
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+            (void) close(fd);
+            conn_free(c);
+            errno = 0;
+            continue;
+        }
+
+        c->fd = fd;
+        c->last_active = time(NULL);
+        c->events = EPOLLIN;
+        c->flow = flow_of(fd, 0);
+
+        struct epoll_event ev;
+        ev.events = c->events;
+        ev.data.ptr = c;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            (void) close(fd);
+            conn_free(c);
+            errno = 0;
+            continue;
+        }
+
+        TRACE(accept, fd);
+        printf("Client connected .\n");
+    }
+}
+
+static void close_connection(struct connection *c) {
+    printf("Close connection to client.\n");
+    /* closing the socket also removes it from the epoll instance */
+    (void) close(c->fd);
+    conn_free(c);
+    if (!accepting) {
+        set_accepting(1);
+    }
+}
+
+static void close_idle_connections(time_t now) {
+    for (int i = 0; i < maxconns; i++) {
+        if (conns[i].fd >= 0 && now - conns[i].last_active >= idle_timeout) {
+            printf("Connection idle for %ds.\n", idle_timeout);
+            close_connection(&conns[i]);
+        }
+    }
+}
+
+static int flow_of(int fd, int id) {
+    /* tcp clients are told apart by their address, clients on the unix socket by their user - the user is the address of a local client */
+    uint64_t key = 0;
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(fd, (struct sockaddr *) &addr, &len) == 0) {
+        if (addr.ss_family == AF_INET) {
+            key = ntohl(((struct sockaddr_in *) &addr)->sin_addr.s_addr);
+        } else if (addr.ss_family == AF_UNIX) {
+            struct ucred cred;
+            socklen_t credlen = sizeof(cred);
+            if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == 0) {
+                /* above all ipv4 addresses, so a user id never hashes like an address */
+                key = (1ull << 32) | (uint32_t) cred.uid;
+            }
+        }
+    }
+    errno = 0;
+    key = (key << 9) | id;
+    /* fibonacci hashing - the top bits of the product are spread well */
+    return (key * 0x9E3779B97F4A7C15ull) >> 56;
+}
+
+static int start_next_brew(void) {
+    while (1) {
+        struct flow *f = &flows[active[current]];
+        if (!visited) {
+            f->deficit += DRR_QUANTUM;
+            visited = 1;
+        }
+        struct brew_sum *next = &f->sums[f->head];
+        int ml = next->ml - f->done.ml;
+        if (ml <= f->deficit) {
+            int seconds = next->seconds - f->done.seconds;
+            f->deficit -= ml;
+            f->done = *next;
+            f->head++;
+            if (f->head == f->tail) {
+                /* the queue is empty - it leaves the round and does not keep its deficit */
+                f->head = 0;
+                f->tail = 0;
+                f->done.ml = 0;
+                f->done.seconds = 0;
+                f->deficit = 0;
+                memmove(&active[current], &active[current + 1], (nactive - current - 1) * sizeof(int));
+                nactive--;
+                if (current == nactive) {
+                    current = 0;
+                }
+                visited = 0;
+            }
+            return seconds;
+        }
+        /* the share of this queue is used up for this turn - next queue */
+        visited = 0;
+        current = (current + 1) % nactive;
+    }
+}
+
+static void start_brews(time_t now) {
+    /* the machine brews the queued coffees one after the other, each one starts when the one before is finished */
+    while (nactive > 0 && brewing_until <= now) {
+        brewing_until += start_next_brew();
+    }
+    if (brewing_until < now) {
+        brewing_until = now;
+    }
+}
+
+static void enqueue_brew(int flow, int seconds, int ml) {
+    struct flow *f = &flows[flow];
+    if (f->tail == f->cap) {
+        if (f->head > 0) {
+            /* move the waiting coffees to the front instead of growing */
+            memmove(f->sums, f->sums + f->head, (f->tail - f->head) * sizeof(struct brew_sum));
+            f->tail -= f->head;
+            f->head = 0;
+        } else {
+            int cap = f->cap == 0 ? 16 : f->cap * 2;
+            struct brew_sum *more = realloc(f->sums, (size_t) cap * sizeof(struct brew_sum));
+            if (more == NULL) {
+                bail_out(EXIT_FAILURE, "could not allocate queue of coffees");
+            }
+            f->sums = more;
+            f->cap = cap;
+        }
+    }
+    struct brew_sum last = f->head == f->tail ? f->done : f->sums[f->tail - 1];
+    if (f->head == f->tail) {
+        /* the queue joins the round at its end */
+        active[nactive++] = flow;
+    }
+    f->sums[f->tail].ml = last.ml + ml;
+    f->sums[f->tail].seconds = last.seconds + seconds;
+    f->tail++;
+}
+
+static time_t finish_time(int flow) {
+    /* in each of its turns a queue brews the longest run of its coffees whose ml fit into the quanta it got so far.
+       so the coffees brewed before the new one are, for every queue, the coffees whose running total of ml
+       fits into the quanta the queue gets until the turn in which the new coffee fits into its own quanta */
+    int pos = 0;
+    while (active[(current + pos) % nactive] != flow) {
+        pos++;
+    }
+    struct flow *g = &flows[flow];
+    struct brew_sum *mine = &g->sums[g->tail - 1];
+    int64_t need = mine->ml - g->done.ml - g->deficit;
+    int64_t turns = (pos == 0 && visited) ? 1 : 0;
+    if (need > 0) {
+        turns += (need + DRR_QUANTUM - 1) / DRR_QUANTUM;
+    }
+    if (turns < 1) {
+        turns = 1;
+    }
+
+    time_t t = brewing_until + (mine->seconds - g->done.seconds);
+    for (int k = 0; k < nactive; k++) {
+        if (k == pos) {
+            continue;
+        }
+        struct flow *f = &flows[active[(current + k) % nactive]];
+        /* queues before this one in the round get as many turns, the ones after it one turn less */
+        int64_t got = k < pos ? turns : turns - 1;
+        if (got == 0) {
+            continue;
+        }
+        int64_t credit = f->deficit + (got - ((k == 0 && visited) ? 1 : 0)) * DRR_QUANTUM;
+        /* binary search for the last coffee that fits */
+        int lo = f->head;
+        int hi = f->tail;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (f->sums[mid].ml - f->done.ml <= credit) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo > f->head) {
+            t += f->sums[lo - 1].seconds - f->done.seconds;
+        }
+    }
+    return t;
+}
+
+static int parity_ok(const uint8_t *buffer) {
+    uint8_t parity_bit = 0;
+    for (int i = 0; i < 9; i++) {
+        int bit = buffer[1] >> i;
+        bit = bit & 1;
+        parity_bit = parity_bit ^ bit;
+    }
+    for (int i = 1; i < 9; i++) {
+        int bit = buffer[0] >> i;
+        bit = bit & 1;
+        parity_bit = parity_bit ^ bit;
+    }
+    return (buffer[0]&1) == parity_bit;
+}
+
+static uint8_t handle_order(const uint8_t *buffer, int flow) {
+    /* OK - 0 coffee can be made
+       NOK - 1 coffee cannot be made 
+       error : 
+            0 - parity bit error at server
+            1 - not enough water left for this amount of coffee
+            2 - no space for cups left
+            3 - no space for cups & not enough water */
+
+    int ok = 0;
+    int error = 0;
+
+    /* check the parity bit */
+    if (!parity_ok(buffer)) {
+        printf("parity bit does not match\n");
+        ok = 1;
+        error = 0;
+    }
+    TRACE(parity, ok == 0);
+
+    int seconds = 0;
+    int size = 0;
+    int flavor = 0;
+
+    if (ok == 0) {
+        /* get size & flavor */
+        uint16_t total = buffer[1];
+        total = total << 8;
+        total = total | buffer[0];
+        size = total >> 1;
+        size = size & 511;
+        flavor = total >> 10;
+        char *coffename = flavor < COUNT_OF(coffeeNames) ? coffeeNames[flavor] : "unknown";
+
+        /* check if enough water & bin space is left for the coffee */
+        if ((ml - size) < 0 && (cups - 1) < 0) {
+            ok = 1;
+            error = 3;
+        } else if ((ml - size) < 0) {
+            ok = 1;
+            error = 1;
+        } else if ((cups - 1) < 0) {
+            ok = 1;
+            error = 2;
+        } else {
+            /* update status of coffemaker */
+            cups --;
+            ml = ml - size;
+            printf("New status: %dml water, %d cups bin\n", ml, cups);
+            /* calculate how long the coffee will take */
+            int brew_seconds = size;
+            if (brew_seconds%10 != 0) {
+                 brew_seconds = brew_seconds + (10-(size%10));
+            }
+            brew_seconds = brew_seconds/10;
+            /* the coffee waits in the queue of its client, the queues take turns by how many ml they ordered,
+               so a client that orders a lot does not make everybody else wait.
+               the time is calculated from the coffees queued now - coffees of other clients that come later
+               may still be brewed before it if its client has used up its share */
+            time_t current_time = time(NULL);
+            start_brews(current_time);
+            enqueue_brew(flow, brew_seconds, size);
+            seconds = finish_time(flow) - current_time;
+            printf("Finish in %ds.\n", seconds);
+            printf("Start coffee of %dml cup with flavour '%s'\n", size, coffename);
+        }
+    }
+
+    TRACE(decision, size, flavor, ok == 0 ? -1 : error, seconds);
+
+    /* message to send: 2 bytes 
+    use an unsigned integer
+    if ok: ------|0|-  time to | ok | wait| parity bit
+    if not ok: --|1|- error code | nok | parity bit */
+
+    uint8_t mess;
+
+    if (ok == 0) {
+        mess = seconds;
+        if (seconds > 63) {
+            mess = 63;
+        }
+        mess = mess << 2;
+        uint8_t parity_bit = 0;
+        for (int i = 0; i < 8; i++) {
+            int bit = mess >> i;
+            bit = bit & 1;
+            parity_bit = parity_bit ^ bit;
+        }
+        mess = mess | parity_bit;
+    } else {
+        mess = error;
+        mess = mess << 1;
+        mess = mess | 1;
+        mess = mess << 1;
+        uint8_t parity_bit = 0;
+        for (int i = 0; i < 8; i++) {
+            int bit = mess >> i;
+            bit = bit & 1;
+            parity_bit = parity_bit ^ bit;
+        }
+        mess = mess | parity_bit;
+    }
+
+    return mess;
+}
+
+static void accept_admin(void) {
+    while (1) {
+        int fd = accept(adminfd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                errno = 0;
+                return;
+            }
+            bail_out(EXIT_FAILURE, "accept on admin socket failed");
+        }
+
+        /* only the user the server runs as and root may change the coffee machine */
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 || (cred.uid != 0 && cred.uid != geteuid())) {
+            const char *denied = "error not allowed\n";
+            (void) send(fd, denied, strlen(denied), MSG_NOSIGNAL | MSG_DONTWAIT);
+            (void) close(fd);
+            errno = 0;
+            continue;
+        }
+
+        struct admin_conn *a = NULL;
+        for (int i = 0; i < ADMIN_CONNS; i++) {
+            if (admins[i].fd < 0) {
+                a = &admins[i];
+                break;
+            }
+        }
+        if (a == NULL || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+            const char *busy = "error too many admin connections\n";
+            (void) send(fd, busy, strlen(busy), MSG_NOSIGNAL | MSG_DONTWAIT);
+            (void) close(fd);
+            errno = 0;
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = a;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            (void) close(fd);
+            errno = 0;
+            continue;
+        }
+        a->fd = fd;
+        a->len = 0;
+    }
+}
+
+static void close_admin(struct admin_conn *a) {
+    (void) close(a->fd);
+    a->fd = -1;
+}
+
+static void admin_command(char *line, char *reply, size_t n) {
+    char *cmd = strtok(line, " \t\r");
+    char *arg1 = strtok(NULL, " \t\r");
+    char *arg2 = strtok(NULL, " \t\r");
+    char *endptr;
+    int ml_capacity = liters*1000;
+
+    if (cmd == NULL || strcmp(cmd, "status") == 0) {
+        /* nothing to change */
+    } else if (strcmp(cmd, "refill") == 0) {
+        /* without an amount the tank is filled up */
+        long add = ml_capacity;
+        if (arg1 != NULL) {
+            errno = 0;
+            add = strtol(arg1, &endptr, 10);
+            if (errno != 0 || endptr == arg1 || *endptr != '\0' || add < 0) {
+                errno = 0;
+                snprintf(reply, n, "error no valid ml - usage: refill [ml]\n");
+                return;
+            }
+        }
+        ml = add >= ml_capacity - ml ? ml_capacity : ml + add;
+    } else if (strcmp(cmd, "empty") == 0) {
+        cups = cups_capacity;
+    } else if (strcmp(cmd, "capacity") == 0) {
+        long new_liters = 0;
+        long new_cups = 0;
+        if (arg1 != NULL && arg2 != NULL) {
+            errno = 0;
+            new_liters = strtol(arg1, &endptr, 10);
+            if (errno != 0 || endptr == arg1 || *endptr != '\0') {
+                new_liters = 0;
+            }
+            new_cups = strtol(arg2, &endptr, 10);
+            if (errno != 0 || endptr == arg2 || *endptr != '\0') {
+                new_cups = 0;
+            }
+            errno = 0;
+        }
+        if (new_liters < 1 || new_liters > INT_MAX / 1000 || new_cups < 1 || new_cups > INT_MAX) {
+            snprintf(reply, n, "error there need to be at least 1 liter and 1 cup - usage: capacity liters cups\n");
+            return;
+        }
+        /* the cups already in the bin stay there, water that does not fit into the new tank is gone */
+        int used = cups_capacity - cups;
+        liters = new_liters;
+        cups_capacity = new_cups;
+        cups = used < cups_capacity ? cups_capacity - used : 0;
+        if (ml > liters*1000) {
+            ml = liters*1000;
+        }
+    } else {
+        snprintf(reply, n, "error unknown command - commands: status, refill [ml], empty, capacity liters cups\n");
+        return;
+    }
+    printf("New status: %dml water, %d cups bin\n", ml, cups);
+    snprintf(reply, n, "ok %d/%dml water, %d/%d cups bin\n", ml, liters*1000, cups, cups_capacity);
+}
+
+static void serve_admin(struct admin_conn *a) {
+    while (1) {
+        ssize_t r = recv(a->fd, a->line + a->len, ADMIN_LINE - a->len, 0);
+        if (r == 0) {
+            close_admin(a);
+            return;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                close_admin(a);
+            }
+            errno = 0;
+            return;
+        }
+        a->len += r;
+
+        /* every complete line is one command - it is applied between two orders, so an order sees all of it or nothing */
+        char *nl;
+        while ((nl = memchr(a->line, '\n', a->len)) != NULL) {
+            *nl = '\0';
+            char reply[ADMIN_LINE];
+            admin_command(a->line, reply, sizeof(reply));
+            if (send(a->fd, reply, strlen(reply), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t) strlen(reply)) {
+                errno = 0;
+                close_admin(a);
+                return;
+            }
+            a->len -= nl + 1 - a->line;
+            memmove(a->line, nl + 1, a->len);
+        }
+        if (a->len == ADMIN_LINE) {
+            const char *toolong = "error command too long\n";
+            (void) send(a->fd, toolong, strlen(toolong), MSG_NOSIGNAL | MSG_DONTWAIT);
+            errno = 0;
+            close_admin(a);
+            return;
+        }
+    }
+}
+
+static int flush_replies(struct connection *c) {
+    while (c->reply_count > 0) {
+        /* the queued replies may wrap around the end of the array - send the part up to the end first */
+        size_t n = c->reply_count;
+        if (c->reply_head + n > CONN_REPLIES) {
+            n = CONN_REPLIES - c->reply_head;
+        }
+        ssize_t s = send(c->fd, c->replies + c->reply_head, n, MSG_NOSIGNAL);
+        if (s < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                errno = 0;
+                return 0;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            errno = 0;
+            return -1;
+        }
+        TRACE(reply, c->fd, s);
+        c->reply_head = (c->reply_head + s) % CONN_REPLIES;
+        c->reply_count -= s;
+    }
+    return 0;
+}
+
+static void serve_connection(struct connection *c, uint32_t events) {
+    int closed = 0;
+
+    c->last_active = time(NULL);
+    if (!c->eof && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        /* read orders as long as there is space left to queue their replies */
+        while (c->reply_count < CONN_REPLIES) {
+            ssize_t r = recv(c->fd, c->frame + c->received, 2 - c->received, 0);
+            if (r == 0) {
+                /* the client sent all its orders - it still gets the replies that are queued */
+                c->eof = 1;
+                break;
+            }
+            if (r < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    errno = 0;
+                    break;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                errno = 0;
+                closed = 1;
+                break;
+            }
+            c->received += r;
+            if (c->received < 2) {
+                continue;
+            }
+            c->received = 0;
+            if (parity_ok(c->frame) && (c->frame[1] >> 2) == CLIENT_ID_FLAVOR) {
+                /* client-id frame - the following orders of this connection go to the queue of this id, no reply */
+                c->flow = flow_of(c->fd, ((c->frame[1] << 8 | c->frame[0]) >> 1) & 511);
+                continue;
+            }
+            TRACE(frame, c->fd, (c->frame[1] << 8) | c->frame[0]);
+            c->replies[(c->reply_head + c->reply_count) % CONN_REPLIES] = handle_order(c->frame, c->flow);
+            c->reply_count++;
+        }
+    }
+
+    /* send message to client - it says if the coffee is going to be made and if so when, if not why not */
+    if (flush_replies(c) == -1 || closed || (c->eof && c->reply_count == 0)) {
+        close_connection(c);
+        return;
+    }
+
+    /* wait for the socket to become writable while replies are left and stop reading while no space is left for more */
+    uint32_t wanted = 0;
+    if (!c->eof && c->reply_count < CONN_REPLIES) {
+        wanted |= EPOLLIN;
+    }
+    if (c->reply_count > 0) {
+        wanted |= EPOLLOUT;
+    }
+    if (wanted != c->events) {
+        struct epoll_event ev;
+        ev.events = wanted;
+        ev.data.ptr = c;
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev) != 0) {
+            errno = 0;
+            close_connection(c);
+            return;
+        }
+        c->events = wanted;
+    }
 }
 
 int main(int argc, char *argv[]) {
@@ -244,12 +1316,12 @@ int main(int argc, char *argv[]) {
 
     parse_args(argc, argv);
 
-    int ml = liters*1000;
+    ml = liters*1000;
+    cups_capacity = cups;
 
     /* create socket sockfd */
     /* AF_INET for ipv4
        SOCK_STREAM for a sequenced, reliable, two-way, connection-based byte stream */
-    int connfd;
     sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
         bail_out(EXIT_FAILURE, "could not create socket");
@@ -297,145 +1369,85 @@ int main(int argc, char *argv[]) {
         bail_out(EXIT_FAILURE, "setup listen failed");
     }
 
-    /* timestamp which says when the last coffee will be finished */
-    time_t last_finished_coffee = time(NULL);
-
-    printf("Initial status : %dml water , %d cups bin\n", ml, cups);
-    printf("Waiting for client...\n");
+    /* clients on the same host can skip the tcp stack and connect through a unix domain socket */
+    if (sockpath != NULL) {
+        unixfd = listen_unix(sockpath);
+    }
 
-    while (1) {
-        /* accept an incoming connection */
-        /* second and third parameter are for the addrinfo from the incoming socket */
-        /* will just reuse hints which I do not need any longer */
-        if ((connfd = accept(sockfd, (struct sockaddr *) &hints, (socklen_t *) &hints)) == -1) {
-            bail_out(EXIT_FAILURE, "accept failed");
+    /* maintenance happens through a separate socket that only the user of the server can use */
+    for (int i = 0; i < ADMIN_CONNS; i++) {
+        admins[i].fd = -1;
+    }
+    if (adminpath != NULL) {
+        adminfd = listen_unix(adminpath);
+        if (chmod(adminpath, S_IRUSR | S_IWUSR) != 0) {
+            bail_out(EXIT_FAILURE, "could not set permissions of admin socket");
         }
+    }
 
-        printf("Client connected .\n");
-
-        static uint8_t buffer[2];
+    /* all connections are records of a pool that is allocated once, so accepting a client never allocates memory */
+    maxconns = fit_fd_limit(maxconns);
+    pool_init(maxconns);
 
-        /* receive message of what the client wants */
-        if (receive_all(connfd, buffer, 2) == NULL) {
-            bail_out(EXIT_FAILURE, "could not receive data from client");
+    /* one epoll instance waits for new connections on the listening sockets and for orders on all connections */
+    epfd = epoll_create1(0);
+    if (epfd < 0) {
+        bail_out(EXIT_FAILURE, "could not create epoll instance");
+    }
+    int *const listeners[] = {&sockfd, &unixfd, &adminfd};
+    for (int i = 0; i < COUNT_OF(listeners); i++) {
+        if (*listeners[i] < 0) {
+            continue;
+        }
+        if (fcntl(*listeners[i], F_SETFL, O_NONBLOCK) != 0) {
+            bail_out(EXIT_FAILURE, "could not make listening socket non-blocking");
         }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = listeners[i];
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, *listeners[i], &ev) != 0) {
+            bail_out(EXIT_FAILURE, "could not register listening socket");
+        }
+    }
 
-        /* OK - 0 coffee can be made
-           NOK - 1 coffee cannot be made 
-           error : 
-                0 - parity bit error at server
-                1 - not enough water left for this amount of coffee
-                2 - no space for cups left
-                3 - no space for cups & not enough water */
+    brewing_until = time(NULL);
 
-        int ok = 0;
-        int error = 0;
+    printf("Initial status : %dml water , %d cups bin\n", ml, cups);
+    printf("Waiting for client...\n");
 
-        /* check the parity bit */
-        uint8_t parity_bit = 0;
-        for (int i = 0; i < 9; i++) {
-            int bit = buffer[1] >> i;
-            bit = bit & 1;
-            parity_bit = parity_bit ^ bit;
-        }
-        for (int i = 1; i < 9; i++) {
-            int bit = buffer[0] >> i;
-            bit = bit & 1;
-            parity_bit = parity_bit ^ bit;
+    static struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        /* wake up once a second to look for idle connections and to retry accepting while records are free */
+        int n = epoll_wait(epfd, events, MAX_EVENTS, idle_timeout > 0 || (!accepting && nfree > 0) ? 1000 : -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                errno = 0;
+                continue;
+            }
+            bail_out(EXIT_FAILURE, "epoll_wait failed");
         }
-        if ((buffer[0]&1) != parity_bit) {
-            printf("parity bit does not match\n");
-            ok = 1;
-            error = 0;
-        }
-
-        int seconds = 0;
-
-        if (ok == 0) {
-            /* get size & flavor */
-            uint16_t total = buffer[1];
-            total = total << 8;
-            total = total | buffer[0];
-            int size = total >> 1;
-            size = size & 511;
-            int flavor = total >> 10;
-            char *coffename = coffeeNames[flavor];
-
-            /* check if enough water & bin space is left for the coffee */
-            if ((ml - size) < 0 && (cups - 1) < 0) {
-                ok = 1;
-                error = 3;
-            } else if ((ml - size) < 0) {
-                ok = 1;
-                error = 1;
-            } else if ((cups - 1) < 0) {
-                ok = 1;
-                error = 2;
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &sockfd || ptr == &unixfd) {
+                accept_clients(*(int *) ptr);
+            } else if (ptr == &adminfd) {
+                accept_admin();
+            } else if ((struct admin_conn *) ptr >= admins && (struct admin_conn *) ptr < admins + ADMIN_CONNS) {
+                serve_admin(ptr);
             } else {
-                /* update status of coffemaker */
-                cups --;
-                ml = ml - size;
-                printf("New status: %dml water, %d cups bin\n", ml, cups);
-                /* calculate how long the coffee will take */
-                int leftover = 0;
-                time_t current_time = time(NULL);
-                if ((long) current_time < (long) last_finished_coffee) {
-                    leftover = (long) last_finished_coffee - (long) current_time;
-                }
-                seconds = size;
-                if (seconds%10 != 0) {
-                     seconds = seconds + (10-(size%10));
-                }
-                seconds = seconds/10;
-                seconds = seconds + leftover;
-                last_finished_coffee = current_time + seconds;
-                printf("Finish in %ds.\n", seconds);
-                printf("Start coffee of %dml cup with flavour '%s'\n", size, coffename);
+                serve_connection(events[i].data.ptr, events[i].events);
             }
         }
-
-        /* message to send: 2 bytes 
-        use an unsigned integer
-        if ok: ------|0|-  time to | ok | wait| parity bit
-        if not ok: --|1|- error code | nok | parity bit */
-
-        uint8_t mess;
-
-        if (ok == 0) {
-            mess = seconds;
-            if (seconds > 63) {
-                mess = 63;
+        time_t now = time(NULL);
+        if (now >= next_sweep) {
+            if (idle_timeout > 0) {
+                close_idle_connections(now);
             }
-            mess = mess << 2;
-            uint8_t parity_bit = 0;
-            for (int i = 0; i < 8; i++) {
-                int bit = mess >> i;
-                bit = bit & 1;
-                parity_bit = parity_bit ^ bit;
+            /* accepting stopped for lack of file descriptors while records are free - there may be descriptors free again */
+            if (!accepting && nfree > 0) {
+                set_accepting(1);
             }
-            mess = mess | parity_bit;
-        } else {
-            mess = error;
-            mess = mess << 1;
-            mess = mess | 1;
-            mess = mess << 1;
-            uint8_t parity_bit = 0;
-            for (int i = 0; i < 8; i++) {
-                int bit = mess >> i;
-                bit = bit & 1;
-                parity_bit = parity_bit ^ bit;
-            }
-            mess = mess | parity_bit;
-        }
-
-        /* send message to client - it says if the coffee is going to be made and if so when, if not why not */
-        if (send_all(connfd, &mess, 1) == -1) {
-            bail_out(EXIT_FAILURE, "sending the information to the client did not work");
-        }
-        printf("Close connection to client.\n");
-        if(connfd >= 0) {
-            (void) close(connfd);
+            next_sweep = now + 1;
         }
-        printf("Waiting for client...\n");
     }
-}
\ No newline at end of file
+}